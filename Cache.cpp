@@ -14,72 +14,70 @@ Cache::Cache() {
 }
 
 /**
- * Insert a CacheItem into the cache. If the cache doesn't have enough room to insert the item, the least recently used (LRU) replacement policy is used to remove one or more items.
+ * Insert a CacheItem into the cache. If the cache doesn't have enough room to insert the item, the least recently used (LRU) replacement policy is used to remove one or more items. The caller keeps its reference to the item and must still release it.
  * @param item - the item to insert
  */
 void Cache::insert(CacheItem* item) {
     pthread_mutex_lock(&lock);
     
-    int index = search(item->url);
+    // If the response exceeds the maximum cache size, don't cache it. The caller can still send it, and
+    // releasing it will delete it.
+    if (item->responseSize > maxSize) {
+        cerr << endl << "Response for the following URL exceeds maximum cache size (" << maxSize << ") and won't be cached: " << item->url << endl << endl;
+        pthread_mutex_unlock(&lock);
+        return;
+    }
     
-    // If the item isn't already in the cache, add it
-    if (index == -1) {
-        // If the response exceeds the maximum cache size
-        if (item->responseSize > maxSize) {
-            cerr << endl << "ERROR: Response for the following URL exceeds maximum cache size (" << maxSize << "): " << item->url << endl << endl;
-            exit(EXIT_FAILURE);
-        }
-        
-        // If there isn't room to add the item without removing other items, keep removing the least
-        // recently used item until there's enough room
-        while (item->responseSize > maxSize - bytesUsed) {
-            CacheItem* lastItem = cache.back();
-            
-            bytesUsed -= lastItem->responseSize;
-            
-            cache.erase(cache.end() - 1);
-            
-            delete lastItem;
-        }
-        
-        // Insert the item at the front so it becomes the new most recently used item
-        cache.insert(cache.begin(), item);
-        
-        bytesUsed += item->responseSize;
+    // A response with "Vary: *" can never be reused, so caching it would only take space from others.
+    // Releasing it will delete it.
+    if (item->varyAll) {
+        pthread_mutex_unlock(&lock);
+        return;
     }
-    // It's already cached, but it's not at index 0, which is where the most recently used element is
-    // kept, so move it there
-    else if (index != 0) {
-        cache.erase(cache.begin() + index);
-        
-        cache.insert(cache.begin(), item);
+    
+    CacheItem* existing = search(item);
+    
+    // If the same variant of the URL is already cached (e.g. two clients missed at the same time),
+    // replace it with the newer copy
+    if (existing != nullptr) {
+        remove(existing);
     }
     
+    // If there isn't room to add the item without removing other items, keep removing the least
+    // recently used item until there's enough room
+    while (item->responseSize > maxSize - bytesUsed) {
+        remove(cache.back());
+    }
+    
+    // Insert the item at the front so it becomes the new most recently used item
+    cache.push_front(item);
+    
+    item->lruPosition = cache.begin();
+    item->cached      = true;
+    
+    variants[item->url].push_back(item);
+    
+    bytesUsed += item->responseSize;
+    
     pthread_mutex_unlock(&lock);
 }
 
 /**
- * If an item is in the cache, return a pointer to it and make it the most recently used item.
- * @param  url  - the URL to search for
- * @return item - a pointer to the CacheItem if found, otherwise nullptr
+ * If an item is in the cache, return a pointer to it and make it the most recently used item. The item stays valid even if it's evicted, until the caller passes it to release.
+ * @param  url            - the normalized URL to search for
+ * @param  requestHeaders - the client's request headers, used to select a variant if the response has a Vary header
+ * @return item           - a pointer to the CacheItem if found, otherwise nullptr
  */
-CacheItem* Cache::access(const string& url) {
-    CacheItem* item = nullptr;
-    
+CacheItem* Cache::access(const string& url, const string& requestHeaders) {
     pthread_mutex_lock(&lock);
     
-    int index = search(url);
+    CacheItem* item = search(url, requestHeaders);
     
-    // If the item is cached, get a pointer to it
-    if (index != -1) {
-        item = cache[index];
+    // If the item is cached, move it to the front of the list to make it the most recently used item
+    if (item != nullptr) {
+        item->refCount++;
         
-        // If the item is not at index 0, move it there to make it the most recently used item
-        if (index != 0) {
-            cache.erase(cache.begin() + index);
-            
-            cache.insert(cache.begin(), item);
-        }
+        cache.splice(cache.begin(), cache, item->lruPosition);
     }
     
     pthread_mutex_unlock(&lock);
@@ -88,22 +86,128 @@ CacheItem* Cache::access(const string& url) {
 }
 
 /**
- * Search the vector for a CacheItem with the provided URL.
+ * Check whether an item is in the cache without making it the most recently used item, so that checks made on no client's behalf don't disturb the LRU order.
+ * @param  url            - the normalized URL to search for
+ * @param  requestHeaders - the request headers, used to select a variant if the response has a Vary header
+ * @return true if the item is cached
+ */
+bool Cache::contains(const string& url, const string& requestHeaders) {
+    pthread_mutex_lock(&lock);
+    
+    bool found = search(url, requestHeaders) != nullptr;
+    
+    pthread_mutex_unlock(&lock);
+    
+    return found;
+}
+
+/**
+ * Give up a reference to an item returned by access or created by the caller. The item is deleted once it's no longer cached and no thread is using it.
+ * @param item - the item to release
+ */
+void Cache::release(CacheItem* item) {
+    pthread_mutex_lock(&lock);
+    
+    item->refCount--;
+    
+    bool unused = item->refCount == 0 && !item->cached;
+    
+    pthread_mutex_unlock(&lock);
+    
+    if (unused) {
+        delete item;
+    }
+}
+
+/**
+ * Remove a CacheItem from the cache. It's only deleted if no thread is still using it; otherwise the last thread to release it deletes it.
  * NOTE: This does not lock!
- * @param  url   - the URL to search for
- * @return index - the index of the CacheItem, or -1 if none is found
+ * @param item - the cached item to remove
  * @private
  */
-int Cache::search(const string& url) {
-    int index = -1;
+void Cache::remove(CacheItem* item) {
+    bytesUsed -= item->responseSize;
+    
+    cache.erase(item->lruPosition);
+    
+    vector<CacheItem*>& urlVariants = variants[item->url];
     
-    for (int i = 0; i < cache.size(); i++) {
-        if (cache[i]->url == url) {
-            index = i;
+    for (int i = 0; i < urlVariants.size(); i++) {
+        if (urlVariants[i] == item) {
+            urlVariants.erase(urlVariants.begin() + i);
             break;
         }
     }
     
-    return index;
+    if (urlVariants.empty()) {
+        variants.erase(item->url);
+    }
+    
+    item->cached = false;
+    
+    if (item->refCount == 0) {
+        delete item;
+    }
+}
+
+/**
+ * Find a cached variant of the provided URL that can be used for the request. The URL is looked up in a hash table, so only its own variants (several may be cached if the responses have a Vary header) are compared against the request.
+ * NOTE: This does not lock!
+ * @param  url            - the normalized URL to search for
+ * @param  requestHeaders - the client's request headers
+ * @return item           - a pointer to the CacheItem, or nullptr if none is found
+ * @private
+ */
+CacheItem* Cache::search(const string& url, const string& requestHeaders) {
+    unordered_map<string, vector<CacheItem*>>::iterator found = variants.find(url);
+    
+    if (found == variants.end()) {
+        return nullptr;
+    }
+    
+    vector<CacheItem*>& urlVariants = found->second;
+    
+    // Variants of a URL almost always vary by the same headers, so the request's secondary key is
+    // only rebuilt when a variant with a different Vary header is found
+    const vector<string>* varyHeaders = nullptr;
+    
+    string variantKey;
+    
+    for (int i = 0; i < urlVariants.size(); i++) {
+        if (varyHeaders == nullptr || *varyHeaders != urlVariants[i]->varyHeaders) {
+            varyHeaders = &urlVariants[i]->varyHeaders;
+            variantKey  = urlVariants[i]->getVariantKey(requestHeaders);
+        }
+        
+        if (urlVariants[i]->matches(variantKey)) {
+            return urlVariants[i];
+        }
+    }
+    
+    return nullptr;
 }
 
+/**
+ * Find a cached item that is the same variant of the same URL as the provided one.
+ * NOTE: This does not lock!
+ * @param  item     - the item to search for
+ * @return existing - a pointer to the cached CacheItem, or nullptr if none is found
+ * @private
+ */
+CacheItem* Cache::search(const CacheItem* item) {
+    unordered_map<string, vector<CacheItem*>>::iterator found = variants.find(item->url);
+    
+    if (found == variants.end()) {
+        return nullptr;
+    }
+    
+    vector<CacheItem*>& urlVariants = found->second;
+    
+    for (int i = 0; i < urlVariants.size(); i++) {
+        if (urlVariants[i]->varyHeaders == item->varyHeaders && urlVariants[i]->matches(item->variantKey)) {
+            return urlVariants[i];
+        }
+    }
+    
+    return nullptr;
+}
@@ -3,6 +3,8 @@
 #define __Cache_hpp__
 
 #include <cstdlib>
+#include <list>
+#include <unordered_map>
 #include <vector>
 
 #include <errno.h>
@@ -14,11 +16,14 @@ using namespace std;
 
 class Cache {
     private:
-        int               bytesUsed;
-        pthread_mutex_t   lock;
-        vector<CacheItem*> cache;
+        int                                        bytesUsed;
+        pthread_mutex_t                            lock;
+        list<CacheItem*>                           cache;    // most recently used first
+        unordered_map<string, vector<CacheItem*>> variants; // every cached variant of each normalized URL
         
-        int search(const string& url);
+        CacheItem* search(const string& url, const string& requestHeaders);
+        CacheItem* search(const CacheItem* item);
+        void       remove(CacheItem* item);
     
     public:
         int maxSize;
@@ -26,7 +31,9 @@ class Cache {
         Cache();
         
         void       insert(CacheItem* item);
-        CacheItem* access(const string& url);
+        CacheItem* access(const string& url, const string& requestHeaders);
+        void       release(CacheItem* item);
+        bool       contains(const string& url, const string& requestHeaders);
 };
 
 #endif
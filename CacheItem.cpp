@@ -1,17 +1,98 @@
 
 #include "CacheItem.hpp"
 
-CacheItem::CacheItem(const string url, const string response, const int responseSize) {
+CacheItem::CacheItem(const string url, const string response, const int responseSize, const string requestHeaders) {
     this->url          = url;
     this->response     = response;
     this->responseSize = responseSize;
     
-    string substring = response.substr(response.find("Content-Length") + 16);
+    // The thread that creates the item holds the first reference to it
+    this->refCount = 1;
+    this->cached   = false;
     
-    substring = substring.substr(0, substring.find("\r"));
+    int headerEnd = response.find("\r\n\r\n");
     
-    this->contentLength = stoi(substring);
+    // If the end of the headers can't be found, treat the whole response as headers
+    this->headerSize = headerEnd == -1 ? responseSize : headerEnd + 4;
+    
+    // The status code follows the HTTP version on the status line, e.g. "HTTP/1.1 200 OK"
+    int spaceIndex = response.find(" ");
+    
+    this->statusCode = 0;
+    
+    if (spaceIndex != -1 && spaceIndex < headerSize) {
+        this->statusCode = atoi(response.c_str() + spaceIndex + 1);
+    }
+    
+    string responseHeaders = response.substr(0, headerSize);
+    
+    string substring = getHeaderValue(responseHeaders, "Content-Length");
+    
+    // Fall back to the size of the body actually received if the server didn't specify a length
+    this->contentLength = substring.empty() ? responseSize - headerSize : atoi(substring.c_str());
     
     //cout << "Content length: " << contentLength << endl;
+    
+    // Split the comma-separated list of header names in Vary, e.g. "Accept-Encoding, User-Agent"
+    string vary = getHeaderValue(responseHeaders, "Vary");
+    
+    this->varyAll = false;
+    
+    int nameStart = 0;
+    
+    while (nameStart < vary.size()) {
+        int nameEnd = vary.find(",", nameStart);
+        
+        if (nameEnd == -1) {
+            nameEnd = vary.size();
+        }
+        
+        string name = vary.substr(nameStart, nameEnd - nameStart);
+        
+        name.erase(0, name.find_first_not_of(" \t"));
+        name.erase(name.find_last_not_of(" \t") + 1);
+        
+        if (name == "*") {
+            varyAll = true;
+        }
+        else if (!name.empty()) {
+            varyHeaders.push_back(toLowerCase(name));
+        }
+        
+        nameStart = nameEnd + 1;
+    }
+    
+    this->variantKey = getVariantKey(requestHeaders);
+}
+
+/**
+ * Build the secondary cache key for a request from the values of the headers this response varies by. Whitespace is removed from the values so that, for example, "gzip, deflate" and "gzip,deflate" select the same variant.
+ * @param  requestHeaders - the request headers (everything after the request line)
+ * @return key            - the header values, one per line, or an empty string if the response doesn't vary
+ */
+string CacheItem::getVariantKey(const string& requestHeaders) const {
+    string key;
+    
+    for (int i = 0; i < varyHeaders.size(); i++) {
+        string value = getHeaderValue(requestHeaders, varyHeaders[i]);
+        
+        for (int j = 0; j < value.size(); j++) {
+            if (value[j] != ' ' && value[j] != '\t') {
+                key += value[j];
+            }
+        }
+        
+        key += '\n';
+    }
+    
+    return key;
 }
 
+/**
+ * Check whether this response can be used for a request with the given secondary cache key.
+ * @param  variantKey - the request's secondary cache key, as returned by getVariantKey
+ * @return true if the response was fetched with the same values for the headers it varies by
+ */
+bool CacheItem::matches(const string& variantKey) const {
+    return !varyAll && this->variantKey == variantKey;
+}
@@ -2,20 +2,36 @@
 #ifndef __CacheItem_hpp__
 #define __CacheItem_hpp__
 
+#include <cstdlib>
 #include <iostream>
+#include <list>
 #include <string>
+#include <vector>
+
+#include "Http.hpp"
 
 using namespace std;
 
 class CacheItem {
     public:
-        string url;
-        string response;
-        int    responseSize;  // size of the entire response in bytes
-        int    contentLength; // as specified by the response header
+        string         url;           // the normalized URL, which is the primary cache key
+        string         response;
+        int            responseSize;  // size of the entire response in bytes
+        int            headerSize;    // size of the status line and headers, including the blank line
+        int            statusCode;    // as specified by the status line
+        int            contentLength; // as specified by the response header
+        bool           varyAll;       // the response has "Vary: *", so it can never be reused
+        vector<string> varyHeaders;   // lowercase names of the request headers listed in Vary
+        string         variantKey;    // the values of those headers in the request that fetched this
+        int            refCount;      // the number of threads using the item (guarded by the cache's lock)
+        bool           cached;        // the item is in the cache, so the cache owns it
+        
+        list<CacheItem*>::iterator lruPosition; // where the item is in the cache's LRU list, while cached
         
-        CacheItem(const string url, const string response, const int responseSize);
+        CacheItem(const string url, const string response, const int responseSize, const string requestHeaders);
+        
+        string getVariantKey(const string& requestHeaders) const;
+        bool   matches(const string& variantKey) const;
 };
 
 #endif
-
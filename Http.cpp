@@ -0,0 +1,197 @@
+
+#include "Http.hpp"
+
+/**
+ * Compare two strings without regard to case, as is required for HTTP header names.
+ * @param  a
+ * @param  b
+ * @return true if the strings are equal ignoring case
+ * @private
+ */
+static bool equalsIgnoreCase(const string& a, const string& b) {
+    if (a.size() != b.size()) {
+        return false;
+    }
+    
+    for (int i = 0; i < a.size(); i++) {
+        if (tolower((unsigned char) a[i]) != tolower((unsigned char) b[i])) {
+            return false;
+        }
+    }
+    
+    return true;
+}
+
+/**
+ * Convert a string to lowercase.
+ * @param  s
+ * @return lower - the lowercase version of s
+ */
+string toLowerCase(const string& s) {
+    string lower = s;
+    
+    for (int i = 0; i < lower.size(); i++) {
+        lower[i] = tolower((unsigned char) lower[i]);
+    }
+    
+    return lower;
+}
+
+/**
+ * Find the value of a header in a block of headers. Header names are matched case-insensitively, and the first line is skipped if it's a request or status line.
+ * @param  headers - the headers, one per line, each ending in "\r\n"
+ * @param  name    - the name of the header to find, without the colon
+ * @return value   - the value with surrounding whitespace removed, or an empty string if not found
+ */
+string getHeaderValue(const string& headers, const string& name) {
+    int lineStart = 0;
+    
+    while (lineStart < headers.size()) {
+        int lineEnd = headers.find("\r\n", lineStart);
+        
+        if (lineEnd == -1) {
+            lineEnd = headers.size();
+        }
+        
+        // An empty line marks the end of the headers
+        if (lineEnd == lineStart) {
+            break;
+        }
+        
+        int colonIndex = headers.find(":", lineStart);
+        
+        if (colonIndex != -1 && colonIndex < lineEnd &&
+            equalsIgnoreCase(headers.substr(lineStart, colonIndex - lineStart), name)) {
+            int valueStart = colonIndex + 1;
+            int valueEnd   = lineEnd;
+            
+            while (valueStart < valueEnd && (headers[valueStart] == ' ' || headers[valueStart] == '\t')) {
+                valueStart++;
+            }
+            
+            while (valueEnd > valueStart && (headers[valueEnd - 1] == ' ' || headers[valueEnd - 1] == '\t')) {
+                valueEnd--;
+            }
+            
+            return headers.substr(valueStart, valueEnd - valueStart);
+        }
+        
+        lineStart = lineEnd + 2;
+    }
+    
+    return "";
+}
+
+/**
+ * Remove every occurrence of a header from a block of headers.
+ * @param  headers - the headers, one per line, each ending in "\r\n"
+ * @param  name    - the name of the header to remove, without the colon
+ * @return result  - the headers without the named header
+ */
+string removeHeader(const string& headers, const string& name) {
+    string result;
+    
+    int lineStart = 0;
+    
+    while (lineStart < headers.size()) {
+        int lineEnd = headers.find("\r\n", lineStart);
+        
+        // Keep anything that isn't a complete line (e.g. a body following the headers) as-is
+        if (lineEnd == -1) {
+            result.append(headers, lineStart, string::npos);
+            break;
+        }
+        
+        int colonIndex = headers.find(":", lineStart);
+        
+        bool matches = colonIndex != -1 && colonIndex < lineEnd &&
+                       equalsIgnoreCase(headers.substr(lineStart, colonIndex - lineStart), name);
+        
+        if (!matches) {
+            result.append(headers, lineStart, lineEnd + 2 - lineStart);
+        }
+        
+        // Everything after the empty line that ends the headers is kept unchanged
+        if (lineEnd == lineStart) {
+            result.append(headers, lineEnd + 2, string::npos);
+            break;
+        }
+        
+        lineStart = lineEnd + 2;
+    }
+    
+    return result;
+}
+
+/**
+ * Parse the value of a Range header against a body of the given size. Only a single range in bytes is supported; anything else (including multiple ranges) is treated as if no range had been requested, which RFC 7233 allows.
+ * @param  value    - the value of the Range header, e.g. "bytes=0-499", "bytes=500-", or "bytes=-500"
+ * @param  bodySize - the size of the full body in bytes
+ * @param  start    - set to the offset of the first byte of the range
+ * @param  end      - set to the offset of the last byte of the range (inclusive)
+ * @return result   - whether the range can be served
+ */
+RangeResult parseRange(const string& value, const int bodySize, int& start, int& end) {
+    const string unit = "bytes=";
+    
+    if (value.size() <= unit.size() || !equalsIgnoreCase(value.substr(0, unit.size()), unit)) {
+        return RANGE_NONE;
+    }
+    
+    string spec = value.substr(unit.size());
+    
+    int dashIndex = spec.find("-");
+    
+    // Multiple ranges would require a multipart/byteranges response, so just send everything
+    if (dashIndex == -1 || spec.find(",") != -1) {
+        return RANGE_NONE;
+    }
+    
+    string first = spec.substr(0, dashIndex);
+    string last  = spec.substr(dashIndex + 1);
+    
+    if (first.find_first_not_of("0123456789") != -1 || last.find_first_not_of("0123456789") != -1 ||
+        (first.empty() && last.empty())) {
+        return RANGE_NONE;
+    }
+    
+    // Limit the number of digits so the conversions below can't overflow
+    if (first.size() > 18 || last.size() > 18) {
+        return RANGE_NONE;
+    }
+    
+    // A suffix range (e.g. "-500") asks for the last N bytes
+    if (first.empty()) {
+        long long suffixLength = stoll(last);
+        
+        if (suffixLength == 0 || bodySize == 0) {
+            return RANGE_UNSATISFIABLE;
+        }
+        
+        start = suffixLength >= bodySize ? 0 : bodySize - (int) suffixLength;
+        end   = bodySize - 1;
+        
+        return RANGE_SATISFIABLE;
+    }
+    
+    long long firstByte = stoll(first);
+    long long lastByte  = last.empty() ? -1 : stoll(last);
+    
+    // An open-ended range (e.g. "500-") runs to the end of the body
+    if (!last.empty() && lastByte < firstByte) {
+        return RANGE_NONE;
+    }
+    
+    if (firstByte >= bodySize) {
+        return RANGE_UNSATISFIABLE;
+    }
+    
+    if (last.empty()) {
+        lastByte = bodySize - 1;
+    }
+    
+    start = (int) firstByte;
+    end   = lastByte >= bodySize ? bodySize - 1 : (int) lastByte;
+    
+    return RANGE_SATISFIABLE;
+}
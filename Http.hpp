@@ -0,0 +1,21 @@
+
+#ifndef __Http_hpp__
+#define __Http_hpp__
+
+#include <cctype>
+#include <string>
+
+using namespace std;
+
+enum RangeResult {
+    RANGE_NONE,          // no usable Range header, so the full response should be sent
+    RANGE_SATISFIABLE,   // a single byte range that falls within the body
+    RANGE_UNSATISFIABLE  // a byte range that starts beyond the end of the body
+};
+
+string      toLowerCase(const string& s);
+string      getHeaderValue(const string& headers, const string& name);
+string      removeHeader(const string& headers, const string& name);
+RangeResult parseRange(const string& value, const int bodySize, int& start, int& end);
+
+#endif
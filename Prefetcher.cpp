@@ -0,0 +1,529 @@
+
+#include "Prefetcher.hpp"
+#include "proxy.hpp"
+
+extern Cache         cache;
+extern UrlNormalizer normalizer;
+
+Prefetcher::Prefetcher() {
+    enabled         = false;
+    maxLinksPerPage = 0;
+    maxQueued       = 64;
+    maxWait         = 2000;
+    
+    int r = pthread_mutex_init(&lock, NULL);
+    
+    if (r == 0) {
+        r = pthread_cond_init(&done, NULL);
+    }
+    
+    if (r == 0) {
+        r = pthread_cond_init(&available, NULL);
+    }
+    
+    if (r != 0) {
+        errno = r;
+        perror("pthread_mutex_init() or pthread_cond_init() failed");
+        exit(EXIT_FAILURE);
+    }
+}
+
+/**
+ * Start the thread that performs the prefetches. There's only one, so prefetching never uses more than one connection at a time.
+ */
+void Prefetcher::start() {
+    pthread_t thread;
+    
+    int r = pthread_create(&thread, NULL, work, (void *) this);
+    
+    if (r != 0) {
+        errno = r;
+        perror("pthread_create() failed");
+        exit(EXIT_FAILURE);
+    }
+}
+
+/**
+ * Queue the same-origin subresources (images, scripts, stylesheets, etc.) of a newly cached HTML page to be fetched into the cache before the client asks for them.
+ * @param item           - the cached response for the page
+ * @param url            - the URL of the page as specified in the client's request
+ * @param requestHeaders - the client's request headers for the page
+ */
+void Prefetcher::scan(const CacheItem* item, const string& url, const string& requestHeaders) {
+    if (!enabled || item->statusCode != 200) {
+        return;
+    }
+    
+    string responseHeaders = item->response.substr(0, item->headerSize);
+    string contentType     = toLowerCase(getHeaderValue(responseHeaders, "Content-Type"));
+    string contentEncoding = toLowerCase(getHeaderValue(responseHeaders, "Content-Encoding"));
+    
+    // Only uncompressed HTML can be scanned for links
+    if (contentType.find("text/html") != 0 || (!contentEncoding.empty() && contentEncoding != "identity")) {
+        return;
+    }
+    
+    vector<string> links;
+    
+    findLinks(item, links);
+    
+    // Send the headers responses most often vary by along with each prefetch, so that the cached
+    // variant is the one the client will ask for
+    const char* forwardedNames[] = { "User-Agent", "Accept-Encoding", "Accept-Language", "Cookie" };
+    
+    string forwardedHeaders;
+    
+    for (int i = 0; i < sizeof forwardedNames / sizeof forwardedNames[0]; i++) {
+        string value = getHeaderValue(requestHeaders, forwardedNames[i]);
+        
+        if (!value.empty()) {
+            forwardedHeaders += string(forwardedNames[i]) + ": " + value + "\r\n";
+        }
+    }
+    
+    vector<PrefetchJob> jobs;
+    set<string>         keys;
+    
+    for (int i = 0; i < links.size() && jobs.size() < maxLinksPerPage; i++) {
+        PrefetchJob job;
+        
+        job.url = resolve(url, links[i]);
+        
+        if (job.url.empty()) {
+            continue;
+        }
+        
+        job.key = normalizer.normalize(job.url);
+        
+        int authorityStart = job.url.find("://") + 3;
+        int authorityEnd   = job.url.find("/", authorityStart);
+        
+        job.request = "GET " + job.url + " HTTP/1.1\r\n"
+                      "Host: " + job.url.substr(authorityStart, authorityEnd - authorityStart) + "\r\n" +
+                      forwardedHeaders +
+                      "Connection: close\r\n\r\n";
+        
+        // Skip links that appear more than once on the page or are already cached
+        if (keys.count(job.key) != 0 || cache.contains(job.key, job.request.substr(job.request.find("\r\n") + 2))) {
+            continue;
+        }
+        
+        keys.insert(job.key);
+        jobs.push_back(job);
+    }
+    
+    pthread_mutex_lock(&lock);
+    
+    for (int i = 0; i < jobs.size() && queue.size() < maxQueued; i++) {
+        // Skip anything another page already queued or a client is already downloading
+        if (pending.count(jobs[i].key) != 0 || clients.count(jobs[i].key) != 0) {
+            continue;
+        }
+        
+        queue.push_back(jobs[i]);
+        pending.insert(jobs[i].key);
+    }
+    
+    if (!queue.empty()) {
+        pthread_cond_signal(&available);
+    }
+    
+    pthread_mutex_unlock(&lock);
+}
+
+/**
+ * Called by a client that missed the cache. If the prefetcher is already fetching the same URL, wait (for at most maxWait milliseconds) for it to finish rather than fetching it twice. If it's only queued, drop it from the queue since the client is about to fetch it anyway.
+ * @param  key      - the normalized URL the client is requesting
+ * @return finished - true if a prefetch of the URL finished while waiting, so the cache should be checked again
+ */
+bool Prefetcher::waitFor(const string& key) {
+    bool finished = false;
+    
+    pthread_mutex_lock(&lock);
+    
+    if (pending.count(key) != 0 && current != key) {
+        for (int i = 0; i < queue.size(); i++) {
+            if (queue[i].key == key) {
+                queue.erase(queue.begin() + i);
+                break;
+            }
+        }
+        
+        pending.erase(key);
+    }
+    
+    if (current == key) {
+        struct timespec deadline;
+        
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        
+        deadline.tv_sec  += maxWait / 1000 + (deadline.tv_nsec + (maxWait % 1000) * 1000000L) / 1000000000L;
+        deadline.tv_nsec  = (deadline.tv_nsec + (maxWait % 1000) * 1000000L) % 1000000000L;
+        
+        // If the prefetch takes too long, give up and let the client fetch it in parallel
+        while (current == key) {
+            if (pthread_cond_timedwait(&done, &lock, &deadline) == ETIMEDOUT) {
+                break;
+            }
+        }
+        
+        finished = current != key;
+    }
+    
+    pthread_mutex_unlock(&lock);
+    
+    return finished;
+}
+
+/**
+ * Called by a client that missed the cache before it fetches the URL itself, so that the prefetcher doesn't queue or start a fetch of the same URL in the meantime. Every call must be matched by a call to endFetch.
+ * @param key - the normalized URL the client is fetching
+ */
+void Prefetcher::beginFetch(const string& key) {
+    if (!enabled) {
+        return;
+    }
+    
+    pthread_mutex_lock(&lock);
+    
+    clients.insert(key);
+    
+    pthread_mutex_unlock(&lock);
+}
+
+/**
+ * Called by a client once its fetch of a URL (registered with beginFetch) is done.
+ * @param key - the normalized URL the client was fetching
+ */
+void Prefetcher::endFetch(const string& key) {
+    if (!enabled) {
+        return;
+    }
+    
+    pthread_mutex_lock(&lock);
+    
+    clients.erase(clients.find(key));
+    
+    pthread_mutex_unlock(&lock);
+}
+
+/**
+ * Fetch queued URLs into the cache one at a time, forever.
+ * @param p - a pointer to the Prefetcher
+ * @private
+ */
+void* Prefetcher::work(void* p) {
+    Prefetcher* prefetcher = (Prefetcher *) p;
+    
+    while (true) {
+        pthread_mutex_lock(&prefetcher->lock);
+        
+        while (prefetcher->queue.empty()) {
+            pthread_cond_wait(&prefetcher->available, &prefetcher->lock);
+        }
+        
+        PrefetchJob job = prefetcher->queue.front();
+        
+        prefetcher->queue.pop_front();
+        
+        // A client may have started downloading it while it was queued
+        if (prefetcher->clients.count(job.key) != 0) {
+            prefetcher->pending.erase(job.key);
+            
+            pthread_mutex_unlock(&prefetcher->lock);
+            continue;
+        }
+        
+        prefetcher->current = job.key;
+        
+        pthread_mutex_unlock(&prefetcher->lock);
+        
+        Clock::time_point startTime = Clock::now();
+        
+        string requestHeaders = job.request.substr(job.request.find("\r\n") + 2);
+        
+        // A client may have fetched it while it was queued
+        if (!cache.contains(job.key, requestHeaders)) {
+            // Stop downloading anything that won't fit in the cache. If the server can't be reached, the
+            // job is just skipped, since no client asked for it.
+            CacheItem* item = nullptr;
+            
+            if (fetchFromServer(job.request, job.url, job.key, cache.maxSize, item) == FETCH_OK &&
+                item->statusCode == 200) {
+                cache.insert(item);
+                
+                chrono::milliseconds ms = chrono::duration_cast<chrono::milliseconds>(Clock::now() - startTime);
+                
+                cout << "-|" << job.url << "|PREFETCH|" << item->contentLength << "|" << ms.count() << endl;
+            }
+            
+            if (item != nullptr) {
+                cache.release(item);
+            }
+        }
+        
+        pthread_mutex_lock(&prefetcher->lock);
+        
+        prefetcher->pending.erase(job.key);
+        prefetcher->current = "";
+        
+        pthread_cond_broadcast(&prefetcher->done);
+        
+        pthread_mutex_unlock(&prefetcher->lock);
+    }
+    
+    return NULL;
+}
+
+/**
+ * Find the URLs of the subresources a browser would load for an HTML page: the src of img, script, and source tags, and the href of link tags for stylesheets, icons, and preloads.
+ * @param item  - the cached response for the page
+ * @param links - the URLs as they appear in the page, in order
+ * @private
+ */
+void Prefetcher::findLinks(const CacheItem* item, vector<string>& links) const {
+    const char* c   = item->response.data() + item->headerSize;
+    const char* end = item->response.data() + item->responseSize;
+    
+    while (c < end) {
+        // memchr is vectorized in common C libraries, so most of the page (the text between tags) is
+        // skipped many bytes at a time
+        const char* tagStart = (const char *) memchr(c, '<', end - c);
+        
+        if (tagStart == nullptr) {
+            break;
+        }
+        
+        const char* tagEnd = (const char *) memchr(tagStart, '>', end - tagStart);
+        
+        if (tagEnd == nullptr) {
+            break;
+        }
+        
+        c = tagStart + 1;
+        
+        string tagName;
+        
+        while (c < tagEnd && isalnum((unsigned char) *c)) {
+            tagName += tolower((unsigned char) *c++);
+        }
+        
+        bool isLinkTag   = tagName == "link";
+        bool isSourceTag = tagName == "img" || tagName == "script" || tagName == "source";
+        
+        if (!isLinkTag && !isSourceTag) {
+            c = tagEnd + 1;
+            continue;
+        }
+        
+        string src;
+        string href;
+        string rel;
+        
+        // Parse the attributes, whose values may be double-quoted, single-quoted, or unquoted
+        while (c < tagEnd) {
+            while (c < tagEnd && (isspace((unsigned char) *c) || *c == '/')) {
+                c++;
+            }
+            
+            string name;
+            
+            while (c < tagEnd && !isspace((unsigned char) *c) && *c != '=' && *c != '/') {
+                name += tolower((unsigned char) *c++);
+            }
+            
+            while (c < tagEnd && isspace((unsigned char) *c)) {
+                c++;
+            }
+            
+            string value;
+            
+            if (c < tagEnd && *c == '=') {
+                c++;
+                
+                while (c < tagEnd && isspace((unsigned char) *c)) {
+                    c++;
+                }
+                
+                if (c < tagEnd && (*c == '"' || *c == '\'')) {
+                    const char* valueEnd = (const char *) memchr(c + 1, *c, tagEnd - c - 1);
+                    
+                    if (valueEnd == nullptr) {
+                        valueEnd = tagEnd;
+                    }
+                    
+                    value.assign(c + 1, valueEnd);
+                    
+                    c = valueEnd < tagEnd ? valueEnd + 1 : tagEnd;
+                }
+                else {
+                    const char* valueStart = c;
+                    
+                    while (c < tagEnd && !isspace((unsigned char) *c)) {
+                        c++;
+                    }
+                    
+                    value.assign(valueStart, c);
+                }
+            }
+            
+            if (name == "src") {
+                src = value;
+            }
+            else if (name == "href") {
+                href = value;
+            }
+            else if (name == "rel") {
+                rel = toLowerCase(value);
+            }
+        }
+        
+        if (isSourceTag && !src.empty()) {
+            links.push_back(src);
+        }
+        else if (isLinkTag && !href.empty() && (rel.find("stylesheet") != -1 || rel.find("icon") != -1 ||
+                                                rel.find("preload") != -1)) {
+            links.push_back(href);
+        }
+        
+        c = tagEnd + 1;
+    }
+}
+
+/**
+ * Remove "." and ".." segments from the path of a URL, as a browser would before requesting it.
+ * @param  path   - a path beginning with '/'
+ * @return result - the path without dot segments
+ */
+static string removeDotSegments(const string& path) {
+    vector<string> segments;
+    
+    int segmentStart = 1;
+    
+    while (segmentStart <= (int) path.size()) {
+        int segmentEnd = path.find("/", segmentStart);
+        
+        if (segmentEnd == -1) {
+            segmentEnd = path.size();
+        }
+        
+        string segment = path.substr(segmentStart, segmentEnd - segmentStart);
+        
+        bool isLast = segmentEnd == path.size();
+        
+        if (segment == "..") {
+            if (!segments.empty()) {
+                segments.pop_back();
+            }
+        }
+        else if (segment != ".") {
+            segments.push_back(segment);
+        }
+        
+        // A trailing dot segment refers to a directory, so keep the trailing slash
+        if (isLast && (segment == "." || segment == "..")) {
+            segments.push_back("");
+        }
+        
+        segmentStart = segmentEnd + 1;
+    }
+    
+    string result;
+    
+    for (int i = 0; i < segments.size(); i++) {
+        result += "/" + segments[i];
+    }
+    
+    return result.empty() ? "/" : result;
+}
+
+/**
+ * Resolve a link found in a page against the page's URL.
+ * @param  base - the absolute URL of the page
+ * @param  link - the link as it appears in the page
+ * @return url  - the absolute URL, or an empty string if it's not an HTTP URL on the page's origin
+ * @private
+ */
+string Prefetcher::resolve(const string& base, const string& link) const {
+    string target = link;
+    
+    // Undo the only character reference that's common in URLs
+    for (int i = target.find("&amp;"); i != -1; i = target.find("&amp;", i + 1)) {
+        target.replace(i, 5, "&");
+    }
+    
+    target.erase(0, target.find_first_not_of(" \t\r\n"));
+    target.erase(target.find_last_not_of(" \t\r\n") + 1);
+    
+    target = target.substr(0, target.find("#"));
+    
+    int baseSchemeEnd = base.find("://");
+    
+    if (target.empty() || baseSchemeEnd == -1) {
+        return "";
+    }
+    
+    int baseAuthorityEnd = base.find_first_of("/?#", baseSchemeEnd + 3);
+    
+    if (baseAuthorityEnd == -1) {
+        baseAuthorityEnd = base.size();
+    }
+    
+    string origin   = base.substr(0, baseAuthorityEnd);
+    string basePath = base.substr(baseAuthorityEnd);
+    
+    basePath = basePath.substr(0, basePath.find_first_of("?#"));
+    
+    if (basePath.empty()) {
+        basePath = "/";
+    }
+    
+    int colonIndex = target.find(":");
+    int slashIndex = target.find_first_of("/?");
+    
+    if (slashIndex == -1) {
+        slashIndex = target.size();
+    }
+    
+    string url;
+    
+    if (target.compare(0, 2, "//") == 0) {
+        url = base.substr(0, baseSchemeEnd + 1) + target;
+    }
+    // A colon before any '/' or '?' means the link has its own scheme (e.g. "http:" or "data:")
+    else if (colonIndex != -1 && colonIndex < slashIndex) {
+        url = target;
+    }
+    else if (target[0] == '/') {
+        url = origin + target;
+    }
+    else if (target[0] == '?') {
+        url = origin + basePath + target;
+    }
+    else {
+        url = origin + basePath.substr(0, basePath.rfind("/") + 1) + target;
+    }
+    
+    int schemeEnd = url.find("://");
+    
+    if (schemeEnd == -1 || toLowerCase(url.substr(0, schemeEnd)) != "http") {
+        return "";
+    }
+    
+    int authorityEnd = url.find_first_of("/?", schemeEnd + 3);
+    
+    if (authorityEnd == -1) {
+        authorityEnd = url.size();
+    }
+    
+    if (toLowerCase(url.substr(0, authorityEnd)) != toLowerCase(origin)) {
+        return "";
+    }
+    
+    int queryIndex = url.find("?", authorityEnd);
+    
+    string path  = url.substr(authorityEnd, queryIndex == -1 ? string::npos : queryIndex - authorityEnd);
+    string query = queryIndex == -1 ? "" : url.substr(queryIndex);
+    
+    return url.substr(0, authorityEnd) + removeDotSegments(path.empty() ? "/" : path) + query;
+}
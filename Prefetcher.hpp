@@ -0,0 +1,57 @@
+
+#ifndef __Prefetcher_hpp__
+#define __Prefetcher_hpp__
+
+#include <chrono>
+#include <cstring>
+#include <deque>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <errno.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "CacheItem.hpp"
+#include "Http.hpp"
+
+using namespace std;
+
+struct PrefetchJob {
+    string url;     // the absolute URL to fetch
+    string key;     // the normalized URL to cache the response under
+    string request; // the full request to send to the server
+};
+
+class Prefetcher {
+    private:
+        pthread_mutex_t     lock;
+        pthread_cond_t      done;
+        pthread_cond_t      available;
+        deque<PrefetchJob>  queue;
+        set<string>         pending; // keys that are queued or being fetched
+        multiset<string>    clients; // keys that clients are fetching themselves (one per client)
+        string              current; // the key being fetched, or an empty string
+        
+        static void* work(void* p);
+        
+        void   findLinks(const CacheItem* item, vector<string>& links) const;
+        string resolve(const string& base, const string& link) const;
+    
+    public:
+        bool enabled;
+        int  maxLinksPerPage; // the most subresources fetched for any one page
+        int  maxQueued;       // the most fetches that may be waiting at once
+        int  maxWait;         // the longest a client waits for a prefetch of the same URL, in milliseconds
+        
+        Prefetcher();
+        
+        void start();
+        void scan(const CacheItem* item, const string& url, const string& requestHeaders);
+        bool waitFor(const string& key);
+        void beginFetch(const string& key);
+        void endFetch(const string& key);
+};
+
+#endif
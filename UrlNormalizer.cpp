@@ -0,0 +1,126 @@
+
+#include "UrlNormalizer.hpp"
+
+UrlNormalizer::UrlNormalizer() {
+    normalizeHost = true;
+    sortQuery     = false;
+}
+
+/**
+ * Normalize a URL for use as a cache key so that URLs referring to the same resource share one cache entry. For example, with the default settings, "HTTP://Example.com:80/a" and "http://example.com/a" both become "http://example.com/a". The fragment is always removed since it's never sent to the server.
+ * @param  url - an absolute URL as found in the request line
+ * @return key - the normalized URL
+ */
+string UrlNormalizer::normalize(const string& url) const {
+    int schemeEnd = url.find("://");
+    
+    // Leave anything that isn't an absolute URL alone
+    if (schemeEnd == -1) {
+        return url;
+    }
+    
+    string scheme = url.substr(0, schemeEnd);
+    
+    int authorityStart = schemeEnd + 3;
+    int authorityEnd   = url.find_first_of("/?#", authorityStart);
+    
+    if (authorityEnd == -1) {
+        authorityEnd = url.size();
+    }
+    
+    string authority = url.substr(authorityStart, authorityEnd - authorityStart);
+    
+    if (normalizeHost) {
+        scheme    = toLowerCase(scheme);
+        authority = toLowerCase(authority);
+        
+        int colonIndex = authority.rfind(":");
+        
+        // Only look for a port after the closing bracket of an IPv6 address, if there is one
+        if (colonIndex != -1 && colonIndex > (int) authority.rfind("]")) {
+            string port = authority.substr(colonIndex + 1);
+            
+            if (port.empty() || (scheme == "http" && port == "80") || (scheme == "https" && port == "443")) {
+                authority.erase(colonIndex);
+            }
+        }
+    }
+    
+    // Drop the fragment, then split what's left into the path and the query
+    string rest = url.substr(authorityEnd);
+    
+    rest = rest.substr(0, rest.find("#"));
+    
+    int queryIndex = rest.find("?");
+    
+    string path  = rest.substr(0, queryIndex);
+    string query = queryIndex == -1 ? "" : rest.substr(queryIndex + 1);
+    
+    if (path.empty()) {
+        path = "/";
+    }
+    
+    string key = scheme + "://" + authority + path;
+    
+    if (query.empty() || (!sortQuery && ignoredParameters.empty())) {
+        return query.empty() ? key : key + "?" + query;
+    }
+    
+    vector<string> parameters;
+    
+    int parameterStart = 0;
+    
+    while (parameterStart <= (int) query.size()) {
+        int parameterEnd = query.find("&", parameterStart);
+        
+        if (parameterEnd == -1) {
+            parameterEnd = query.size();
+        }
+        
+        string parameter = query.substr(parameterStart, parameterEnd - parameterStart);
+        
+        if (!parameter.empty() && !isIgnoredParameter(parameter)) {
+            parameters.push_back(parameter);
+        }
+        
+        parameterStart = parameterEnd + 1;
+    }
+    
+    // Sort by name only, keeping repeated parameters in their original order since that may matter
+    if (sortQuery) {
+        stable_sort(parameters.begin(), parameters.end(), [](const string& a, const string& b) {
+            return a.substr(0, a.find("=")) < b.substr(0, b.find("="));
+        });
+    }
+    
+    for (int i = 0; i < parameters.size(); i++) {
+        key += (i == 0 ? "?" : "&") + parameters[i];
+    }
+    
+    return key;
+}
+
+/**
+ * Check whether a query parameter should be removed from cache keys.
+ * @param  parameter - the parameter, e.g. "utm_source=newsletter"
+ * @return true if the parameter's name matches one of the ignored parameters
+ * @private
+ */
+bool UrlNormalizer::isIgnoredParameter(const string& parameter) const {
+    string name = parameter.substr(0, parameter.find("="));
+    
+    for (int i = 0; i < ignoredParameters.size(); i++) {
+        const string& ignored = ignoredParameters[i];
+        
+        if (!ignored.empty() && ignored.back() == '*') {
+            if (name.compare(0, ignored.size() - 1, ignored, 0, ignored.size() - 1) == 0) {
+                return true;
+            }
+        }
+        else if (name == ignored) {
+            return true;
+        }
+    }
+    
+    return false;
+}
@@ -0,0 +1,27 @@
+
+#ifndef __UrlNormalizer_hpp__
+#define __UrlNormalizer_hpp__
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "Http.hpp"
+
+using namespace std;
+
+class UrlNormalizer {
+    private:
+        bool isIgnoredParameter(const string& parameter) const;
+    
+    public:
+        bool           normalizeHost;     // lowercase the scheme and host and remove the default port
+        bool           sortQuery;         // sort query parameters by name
+        vector<string> ignoredParameters; // query parameters to remove (a trailing '*' matches a prefix)
+        
+        UrlNormalizer();
+        
+        string normalize(const string& url) const;
+};
+
+#endif
@@ -1,15 +1,57 @@
 
 #include "proxy.hpp"
 
-Cache cache;
+Cache         cache;
+UrlNormalizer normalizer;
+Prefetcher    prefetcher;
 
 int main(int argc, char* argv[]) {
-    if (argc != 2) {
-        cerr << "Usage: " << argv[0] << " <max-cache-size>" << endl;
+    // Writing to a socket the client has closed raises SIGPIPE, which would otherwise kill the whole
+    // proxy. With it ignored, send just fails and only that client's thread gives up.
+    signal(SIGPIPE, SIG_IGN);
+    
+    int option;
+    
+    // -r: use the scheme, host, and port exactly as requested in cache keys
+    // -s: sort query parameters by name in cache keys
+    // -i: remove a query parameter from cache keys (may be repeated; a trailing '*' matches a prefix)
+    // -p: prefetch up to this many subresources of each HTML page that misses the cache
+    while ((option = getopt(argc, argv, "rsi:p:")) != -1) {
+        switch (option) {
+            case 'r':
+                normalizer.normalizeHost = false;
+                break;
+            case 's':
+                normalizer.sortQuery = true;
+                break;
+            case 'i':
+                normalizer.ignoredParameters.push_back(optarg);
+                break;
+            case 'p':
+                prefetcher.enabled         = true;
+                prefetcher.maxLinksPerPage = atoi(optarg);
+                
+                // Anything that isn't a positive number (atoi returns 0 for non-numbers) prints the usage message
+                if (prefetcher.maxLinksPerPage < 1) {
+                    optind = argc;
+                }
+                break;
+            default:
+                optind = argc;
+                break;
+        }
+    }
+    
+    if (argc - optind != 1) {
+        cerr << "Usage: " << argv[0] << " [-r] [-s] [-i <query-parameter>]... [-p <links-per-page>] <max-cache-size>" << endl;
         exit(EXIT_FAILURE);
     }
 
-    cache.maxSize = stoi(argv[1]);
+    cache.maxSize = stoi(argv[optind]);
+    
+    if (prefetcher.enabled) {
+        prefetcher.start();
+    }
     
     // Create a TCP socket
     int mySocket = socket(AF_INET, SOCK_STREAM, 0);
@@ -120,9 +162,11 @@ void* requestHandler(void* ci) {
     
     // Read the request from the client
     // (recv seems to be able to get the entire request in one go since it's small)
+    // If the client reset the connection, only this thread needs to stop
     if (byteCount == -1) {
         perror("recv() failed");
-        exit(EXIT_FAILURE);
+        close(clientSocket);
+        return NULL;
     }
     
     // If this occurs, the recv call above will have to go in a loop
@@ -150,15 +194,40 @@ void* requestHandler(void* ci) {
     
     //cout << "URL: " << url << endl << endl;
     
+    // Normalize the URL so that equivalent URLs share a cache entry
+    string key = normalizer.normalize(url);
+    
+    //cout << "Key: " << key << endl << endl;
+    
+    string requestHeaders = requestString.substr(requestString.find("\r\n") + 2);
+    
     string hitOrMiss;
     
-    // Check if the item is already in the cache and make it the most recently used item if so
-    CacheItem* item = cache.access(url);
+    // Check if the item (or the right variant of it, if the response has a Vary header) is already in
+    // the cache and make it the most recently used item if so
+    CacheItem* item = cache.access(key, requestHeaders);
+    
+    bool fetching = item == nullptr;
+    
+    // Let the prefetcher know this client is fetching it, so the prefetcher doesn't fetch it too
+    if (fetching) {
+        prefetcher.beginFetch(key);
+    }
+    
+    // If the prefetcher is already fetching it, wait for that instead of fetching it again
+    if (item == nullptr && prefetcher.enabled && prefetcher.waitFor(key)) {
+        item = cache.access(key, requestHeaders);
+    }
+    
+    // A range request only downloads the whole object if it will fit in the cache
+    bool hasRange = !getHeaderValue(requestHeaders, "Range").empty();
+    
+    FetchResult fetch = FETCH_OK;
     
     // If the response is not already cached, forward the request to the server, cache the response,
     // and return it from talkToServer
     if (item == nullptr) {
-        item = talkToServer(requestString, url);
+        fetch = talkToServer(requestString, url, key, hasRange ? cache.maxSize : -1, item);
         
         hitOrMiss = "CACHE_MISS";
     }
@@ -166,48 +235,64 @@ void* requestHandler(void* ci) {
         hitOrMiss = "CACHE_HIT";
     }
     
-    // Make the buffer the exact size of the cached response
-    // Put it on the heap so that it can handle large files
-    char* fullResponseBuffer = new char[item->responseSize];
-    
-    // Copy the memory from the array version of the response string to the buffer. Use the data
-    // method instead of the c_str method so it works with binary data, which may contain the null
-    // terminator anywhere. Because it's not an ordinary null-terminated C string, it's necessary to
-    // keep track of the length (hence the responseSize field).
-    memcpy(fullResponseBuffer, item->response.data(), item->responseSize);
-    
-    //cout << endl << fullResponseBuffer << endl;
-    
-    int fullLength = item->responseSize;
-    int bytesSent  = 0;
-    int bytesLeft  = fullLength;
-    int r          = -1;
+    if (fetching) {
+        prefetcher.endFetch(key);
+    }
     
+    int rangeStart = 0;
+    int rangeEnd   = 0;
     
-    // TODO: Send response headers first. If sending a big file, this is good for the client so it knows how large the file is and can display a progress bar.
+    // The whole object is always cached, so a Range request can be answered by slicing the body
+    RangeResult range = item == nullptr ? RANGE_NONE : checkRange(requestHeaders, item, rangeStart, rangeEnd);
     
+    int contentLength = item == nullptr ? 0 : item->contentLength;
     
-    // While the response has not been fully sent (large files won't be sent all at once)
-    // https://beej.us/guide/bgnet/output/html/multipage/advanced.html#sendall
-    while (bytesSent < fullLength) {
-        // Send the server's response to the client
-        r = send(clientSocket, fullResponseBuffer + bytesSent, bytesLeft, 0);
+    // If the object is too large to cache, pass the request through to the server and the server's
+    // (partial) response back to the client as it arrives. If the server can't be reached, tell the
+    // client (without trying to connect to it a second time).
+    if (item == nullptr) {
+        contentLength = fetch == FETCH_TOO_LARGE ? relayFromServer(clientSocket, requestString, url) : -1;
         
-        if (r == -1) {
-            perror("send() failed");
-            exit(EXIT_FAILURE);
+        if (contentLength == -1) {
+            string gatewayError = "HTTP/1.1 502 Bad Gateway\r\n"
+                                  "Content-Length: 0\r\n"
+                                  "Connection: close\r\n\r\n";
+            
+            sendAll(clientSocket, gatewayError.data(), gatewayError.size());
+            
+            contentLength = 0;
         }
+    }
+    // The reference taken by access (or held since talkToServer created the item) keeps the item
+    // alive until it's released below, even if another thread evicts it, so the response can be sent
+    // straight out of the cache without copying it first
+    else if (range == RANGE_SATISFIABLE) {
+        string partialHeader = buildPartialResponseHeader(item, rangeStart, rangeEnd);
         
-        bytesSent += r;
-        bytesLeft -= r;
+        if (sendAll(clientSocket, partialHeader.data(), partialHeader.size())) {
+            sendAll(clientSocket, item->response.data() + item->headerSize + rangeStart, rangeEnd - rangeStart + 1);
+        }
+    }
+    else if (range == RANGE_UNSATISFIABLE) {
+        string rangeError = "HTTP/1.1 416 Range Not Satisfiable\r\n"
+                            "Content-Range: bytes */" + to_string(item->responseSize - item->headerSize) + "\r\n"
+                            "Content-Length: 0\r\n"
+                            "Connection: close\r\n\r\n";
+        
+        sendAll(clientSocket, rangeError.data(), rangeError.size());
+    }
+    else {
+        // TODO: Send response headers first. If sending a big file, this is good for the client so it knows how large the file is and can display a progress bar.
+        
+        
+        // Use the data method instead of the c_str method so it works with binary data, which may
+        // contain the null terminator anywhere. Because it's not an ordinary null-terminated C string,
+        // it's necessary to keep track of the length (hence the responseSize field).
+        sendAll(clientSocket, item->response.data(), item->responseSize);
     }
     
-//    cout << "Full length: " << fullLength << endl;
-//    cout << "Bytes sent:  " << bytesSent  << endl;
-//    cout << "Bytes left:  " << bytesLeft  << endl;
-//    cout << "r:           " << r          << endl;
-    
-    // Close the client's socket file descriptor
+    // Close the client's socket file descriptor. This happens even if sending failed, and the item is
+    // still released below.
     if (close(clientSocket) == -1) {
         perror("close() failed");
         exit(EXIT_FAILURE);
@@ -219,83 +304,151 @@ void* requestHandler(void* ci) {
     // Get the duration in milliseconds
     chrono::milliseconds ms = chrono::duration_cast<chrono::milliseconds>(stopTime - startTime);
     
-    cout << ipAddress << "|" << url << "|" << hitOrMiss << "|" << item->contentLength << "|" << ms.count() << endl;
+    cout << ipAddress << "|" << url << "|" << hitOrMiss << "|" << contentLength << "|" << ms.count() << endl;
     
-    delete [] fullResponseBuffer;
+    // Now that the page has been sent, queue its images, scripts, and stylesheets so they're cached
+    // before they're requested
+    if (item != nullptr && hitOrMiss == "CACHE_MISS") {
+        prefetcher.scan(item, url, requestHeaders);
+    }
+    
+    if (item != nullptr) {
+        cache.release(item);
+    }
     
     // Avoid a compiler warning (the null value isn't used anywhere)
     return NULL;
 }
 
 /**
- * Forward the client's request to the server and cache the server's response. (This function is only called if a response isn't already cached.)
- * @param  request - the client's full request
- * @param  url     - the URL of the server as specified in the client's request
- * @return item    - a pointer to the newly cached item
+ * Decide whether a cached response can be used to answer the client's Range request, if there is one.
+ * @param  requestHeaders - the client's request headers (everything after the request line)
+ * @param  item           - the cached response
+ * @param  start          - set to the offset of the first byte of the range within the body
+ * @param  end            - set to the offset of the last byte of the range within the body (inclusive)
+ * @return range          - RANGE_NONE if the full response should be sent
  */
-CacheItem* talkToServer(const string& request, const string& url) {
-    // Get a substring of the request containing only the headers (everything after line 1)
-    string requestHeaders = request.substr(request.find("\r\n") + 2);
+RangeResult checkRange(const string& requestHeaders, const CacheItem* item, int& start, int& end) {
+    string rangeValue = getHeaderValue(requestHeaders, "Range");
     
-    //cout << endl << "Request headers:\n" << requestHeaders << endl;
+    // Only a complete (200 OK) response with an unchunked body can be sliced by byte offset
+    if (rangeValue.empty() || item->statusCode != 200) {
+        return RANGE_NONE;
+    }
     
-    int hostIndex = requestHeaders.find("Host:") + 6;
+    string responseHeaders = item->response.substr(0, item->headerSize);
     
-    string hostName = "";
+    if (!getHeaderValue(responseHeaders, "Transfer-Encoding").empty()) {
+        return RANGE_NONE;
+    }
     
-    // Extract the host name from the string containing all the headers
-    for (int i = hostIndex; i < requestHeaders.size(); i++) {
-        if (requestHeaders[i] == '\r') {
-            break;
-        }
+    // If-Range makes the range conditional on the client's copy still being current. If the validator
+    // doesn't match the cached one, the client needs the whole object instead. RFC 7233 requires a
+    // strong comparison, so a weak ETag (W/"...") never matches.
+    string ifRange = getHeaderValue(requestHeaders, "If-Range");
+    
+    if (!ifRange.empty()) {
+        string eTag = getHeaderValue(responseHeaders, "ETag");
         
-        hostName += requestHeaders[i];
+        bool eTagMatches = !eTag.empty() && eTag.compare(0, 2, "W/") != 0 && ifRange == eTag;
+        
+        if (!eTagMatches && ifRange != getHeaderValue(responseHeaders, "Last-Modified")) {
+            return RANGE_NONE;
+        }
     }
     
-    //cout << "Host name: " << hostName << endl;
-    
-    string portString;
+    return parseRange(rangeValue, item->responseSize - item->headerSize, start, end);
+}
+
+/**
+ * Build the status line and headers of a 206 Partial Content response from those of a cached response.
+ * @param  item   - the cached response
+ * @param  start  - the offset of the first byte of the range within the body
+ * @param  end    - the offset of the last byte of the range within the body (inclusive)
+ * @return header - the new status line and headers, including the blank line that ends them
+ */
+string buildPartialResponseHeader(const CacheItem* item, const int start, const int end) {
+    // Skip the original status line and the blank line at the end of the headers
+    int statusLineEnd = item->response.find("\r\n") + 2;
     
-    // Account for additional characters when the port is not 80
-    int extraSize;
+    string headers = item->response.substr(statusLineEnd, item->headerSize - 2 - statusLineEnd);
     
-    int colonIndex = hostName.find(":");
+    headers = removeHeader(headers, "Content-Length");
+    headers = removeHeader(headers, "Content-Range");
     
-    // If a colon wasn't found, assume port 80
-    if (colonIndex == -1) {
-        portString = "80";
-        extraSize  = 0;
-    }
-    else {
-        // Extract the port
-        portString = hostName.substr(colonIndex + 1);
-        extraSize  = portString.size() + 1;
-        
-        // Remove the part of the host name string containing the colon and port
-        hostName.erase(colonIndex);
-    }
+    string header = "HTTP/1.1 206 Partial Content\r\n" + headers;
     
-    //cout << "Port:      " << portString << endl;
+    header += "Content-Range: bytes " + to_string(start) + "-" + to_string(end) + "/" +
+              to_string(item->responseSize - item->headerSize) + "\r\n";
+    header += "Content-Length: " + to_string(end - start + 1) + "\r\n\r\n";
     
-    // Parse the path from the URL
-    string path = url.substr(url.find(hostName) + hostName.size() + extraSize);
+    return header;
+}
+
+/**
+ * Send an entire buffer, calling send as many times as needed (large files won't be sent all at once)
+ * https://beej.us/guide/bgnet/output/html/multipage/advanced.html#sendall
+ * @param  socket - the socket file descriptor to send on
+ * @param  buffer - the data to send, which may be binary
+ * @param  length - the number of bytes to send
+ * @return true if everything was sent, or false if the connection failed (e.g. the client reset it,
+ *         which players and download managers do whenever they seek)
+ */
+bool sendAll(const int& socket, const char* buffer, const int& length) {
+    int bytesSent = 0;
+    int bytesLeft = length;
     
-    //cout << "Path: " << path << endl;
+    while (bytesSent < length) {
+        int r = send(socket, buffer + bytesSent, bytesLeft, 0);
+        
+        if (r == -1) {
+            perror("send() failed");
+            return false;
+        }
+        
+        bytesSent += r;
+        bytesLeft -= r;
+    }
     
-    string newRequestLine = "GET " + path + " HTTP/1.1\r\n";
-    string newRequest     = newRequestLine + requestHeaders;
+    return true;
+}
+
+/**
+ * Forward the client's request to the server and cache the server's response. (This function is only called if a response isn't already cached.)
+ * @param  request   - the client's full request
+ * @param  url       - the URL of the server as specified in the client's request
+ * @param  key       - the normalized URL to cache the response under
+ * @param  sizeLimit - the largest response to download in bytes, or -1 for no limit
+ * @param  item      - set to a pointer to the newly cached item, which the caller must release, if the fetch succeeded
+ * @return result    - whether the fetch succeeded, and if not, why
+ */
+FetchResult talkToServer(const string& request, const string& url, const string& key, const int sizeLimit, CacheItem*& item) {
+    FetchResult result = fetchFromServer(request, url, key, sizeLimit, item);
     
-    //cout << endl << newRequest << endl;
+    // Cache the response
+    if (result == FETCH_OK) {
+        cache.insert(item);
+    }
     
-    // Set up a connection between this proxy and the server
-    int serverSocket = connectToServer(hostName, portString);
+    return result;
+}
+
+/**
+ * Forward a request to the server and return its response without caching it. The Range and If-Range headers are removed so that the whole object is fetched.
+ * @param  request   - the full request
+ * @param  url       - the URL of the server as specified in the request
+ * @param  key       - the normalized URL the response will be cached under
+ * @param  sizeLimit - the largest response to download in bytes, or -1 for no limit
+ * @param  item      - set to a pointer to a new CacheItem containing the response if the fetch succeeded
+ * @return result    - FETCH_TOO_LARGE if the response is larger than sizeLimit, or FETCH_FAILED if the server couldn't be reached or the response was cut off
+ */
+FetchResult fetchFromServer(const string& request, const string& url, const string& key, const int sizeLimit, CacheItem*& item) {
+    item = nullptr;
     
-    const char* newRequestBuffer = newRequest.c_str();
+    int serverSocket = sendRequestToServer(request, url, false);
     
-    // Send the new GET request to the server
-    if (send(serverSocket, newRequestBuffer, strlen(newRequestBuffer) + 1, 0) == -1) {
-        perror("send() failed");
-        exit(EXIT_FAILURE);
+    if (serverSocket == -1) {
+        return FETCH_FAILED;
     }
     
     // 2 ^ 17
@@ -304,6 +457,7 @@ CacheItem* talkToServer(const string& request, const string& url) {
     string fullResponse;
     
     int fullResponseSize = 0;
+    int expectedSize     = -1;
     
     // Loop until all of the response data is received
     while (true) {
@@ -313,9 +467,11 @@ CacheItem* talkToServer(const string& request, const string& url) {
         // receive it
         int byteCount = recv(serverSocket, responseBuffer, responseBufferSize, 0);
         
+        // Don't cache a response that was cut off
         if (byteCount == -1) {
             perror("recv() failed");
-            exit(EXIT_FAILURE);
+            close(serverSocket);
+            return FETCH_FAILED;
         }
         
         // The server closed the connection, so all data has been sent
@@ -333,23 +489,209 @@ CacheItem* talkToServer(const string& request, const string& url) {
         fullResponse.append(responseBuffer, byteCount);
         
         fullResponseSize += byteCount;
+        
+        if (sizeLimit == -1) {
+            continue;
+        }
+        
+        // Check the length the server announces as soon as the headers arrive so that a response
+        // that's too large isn't downloaded just to be thrown away
+        if (expectedSize == -1) {
+            int headerEnd = fullResponse.find("\r\n\r\n");
+            
+            if (headerEnd != -1) {
+                string contentLength = getHeaderValue(fullResponse.substr(0, headerEnd + 4), "Content-Length");
+                
+                expectedSize = headerEnd + 4 + (contentLength.empty() ? 0 : atoll(contentLength.c_str()));
+            }
+        }
+        
+        if (fullResponseSize > sizeLimit || expectedSize > sizeLimit) {
+            close(serverSocket);
+            return FETCH_TOO_LARGE;
+        }
     }
     
-    // Close the server's socket file descriptor
+    // Close the server's socket file descriptor (the whole response has already been received, so a
+    // failure here doesn't matter)
     if (close(serverSocket) == -1) {
         perror("close() failed");
-        exit(EXIT_FAILURE);
     }
     
     //cout << endl << fullResponse << endl << endl;
     
+    string requestHeaders = request.substr(request.find("\r\n") + 2);
+    
     // Create a new CacheItem for the resource specified by the URL, containing the server's response
-    CacheItem* item = new CacheItem(url, fullResponse, fullResponseSize);
+    item = new CacheItem(key, fullResponse, fullResponseSize, requestHeaders);
     
-    // Cache the response
-    cache.insert(item);
+    return FETCH_OK;
+}
+
+/**
+ * Forward the client's request to the server unchanged (including any Range header) and pass the server's response to the client as it arrives, without caching it. This is used for range requests for objects too large to cache.
+ * @param  clientSocket - the client's socket file descriptor
+ * @param  request      - the client's full request
+ * @param  url          - the URL of the server as specified in the client's request
+ * @return bodySize     - the size of the response body in bytes (as logged for other responses), or -1 if the server couldn't be reached
+ */
+int relayFromServer(const int& clientSocket, const string& request, const string& url) {
+    int serverSocket = sendRequestToServer(request, url, true);
+    
+    if (serverSocket == -1) {
+        return -1;
+    }
+    
+    // 2 ^ 17
+    const int responseBufferSize = 131072;
+    
+    char responseBuffer[responseBufferSize];
+    
+    int bytesRelayed = 0;
+    
+    // The status line and headers, kept until the blank line that ends them has arrived so that only
+    // the body is counted
+    string headers;
+    
+    int headerSize = -1;
+    
+    while (true) {
+        int byteCount = recv(serverSocket, responseBuffer, responseBufferSize, 0);
+        
+        // If part of the response has already been sent, all that can be done is to stop
+        if (byteCount == -1) {
+            perror("recv() failed");
+            
+            if (bytesRelayed == 0) {
+                bytesRelayed = -1;
+            }
+            
+            break;
+        }
+        
+        // The server closed the connection, so all data has been sent
+        if (byteCount == 0) {
+            break;
+        }
+        
+        // The client went away, so there's no point in receiving the rest
+        if (!sendAll(clientSocket, responseBuffer, byteCount)) {
+            break;
+        }
+        
+        bytesRelayed += byteCount;
+        
+        if (headerSize == -1) {
+            headers.append(responseBuffer, byteCount);
+            
+            int headerEnd = headers.find("\r\n\r\n");
+            
+            if (headerEnd != -1) {
+                headerSize = headerEnd + 4;
+            }
+            // Don't hold on to an unbounded amount of a response that never ends its headers
+            else if (headers.size() > responseBufferSize) {
+                headerSize = 0;
+            }
+        }
+    }
+    
+    if (close(serverSocket) == -1) {
+        perror("close() failed");
+    }
+    
+    if (bytesRelayed == -1) {
+        return -1;
+    }
+    
+    return headerSize == -1 ? 0 : bytesRelayed - headerSize;
+}
+
+/**
+ * Rewrite a request for the server (with just the path in the request line), connect to the server, and send it.
+ * @param  request      - the full request, with the URL in the request line
+ * @param  url          - the URL of the server as specified in the request
+ * @param  keepRange    - whether to keep the Range and If-Range headers
+ * @return serverSocket - the socket file descriptor connected to the server, ready to receive the response, or -1 if the request couldn't be sent
+ */
+int sendRequestToServer(const string& request, const string& url, const bool keepRange) {
+    // Get a substring of the request containing only the headers (everything after line 1)
+    string requestHeaders = request.substr(request.find("\r\n") + 2);
+    
+    // Fetch the whole object unless told otherwise, so that it can be cached under the URL and any
+    // later Range request for it can be served from the cache
+    if (!keepRange) {
+        requestHeaders = removeHeader(requestHeaders, "Range");
+        requestHeaders = removeHeader(requestHeaders, "If-Range");
+    }
+    
+    //cout << endl << "Request headers:\n" << requestHeaders << endl;
+    
+    int hostIndex = requestHeaders.find("Host:") + 6;
+    
+    string hostName = "";
+    
+    // Extract the host name from the string containing all the headers
+    for (int i = hostIndex; i < requestHeaders.size(); i++) {
+        if (requestHeaders[i] == '\r') {
+            break;
+        }
+        
+        hostName += requestHeaders[i];
+    }
+    
+    //cout << "Host name: " << hostName << endl;
+    
+    string portString;
+    
+    // Account for additional characters when the port is not 80
+    int extraSize;
+    
+    int colonIndex = hostName.find(":");
+    
+    // If a colon wasn't found, assume port 80
+    if (colonIndex == -1) {
+        portString = "80";
+        extraSize  = 0;
+    }
+    else {
+        // Extract the port
+        portString = hostName.substr(colonIndex + 1);
+        extraSize  = portString.size() + 1;
+        
+        // Remove the part of the host name string containing the colon and port
+        hostName.erase(colonIndex);
+    }
+    
+    //cout << "Port:      " << portString << endl;
     
-    return item;
+    // Parse the path from the URL
+    string path = url.substr(url.find(hostName) + hostName.size() + extraSize);
+    
+    //cout << "Path: " << path << endl;
+    
+    string newRequestLine = "GET " + path + " HTTP/1.1\r\n";
+    string newRequest     = newRequestLine + requestHeaders;
+    
+    //cout << endl << newRequest << endl;
+    
+    // Set up a connection between this proxy and the server
+    int serverSocket = connectToServer(hostName, portString);
+    
+    if (serverSocket == -1) {
+        return -1;
+    }
+    
+    const char* newRequestBuffer = newRequest.c_str();
+    
+    // Send the new GET request to the server
+    if (send(serverSocket, newRequestBuffer, strlen(newRequestBuffer) + 1, 0) == -1) {
+        perror("send() failed");
+        close(serverSocket);
+        return -1;
+    }
+    
+    return serverSocket;
 }
 
 /**
@@ -357,7 +699,7 @@ CacheItem* talkToServer(const string& request, const string& url) {
  * https://beej.us/guide/bgnet/output/html/multipage/getaddrinfoman.html
  * @param  hostName      - the host name of the server
  * @param  port          - the port to use, in string form for use with getaddrinfo
- * @return serverSocket  - the socket file descriptor used for the connection to the server
+ * @return serverSocket  - the socket file descriptor used for the connection to the server, or -1 if the connection failed
  */
 int connectToServer(const string& hostName, const string& port) {
     struct addrinfo  hints;
@@ -367,7 +709,7 @@ int connectToServer(const string& hostName, const string& port) {
     memset(&hints, 0, sizeof hints);
     
     hints.ai_family   = AF_UNSPEC;
-    hints.ai_socktype = 0;
+    hints.ai_socktype = SOCK_STREAM; // otherwise a UDP socket can "connect" when TCP is refused
     
     int gaiResult;
     
@@ -375,7 +717,7 @@ int connectToServer(const string& hostName, const string& port) {
     // is the server the client wants to reach through the proxy
     if ((gaiResult = getaddrinfo(hostName.c_str(), port.c_str(), &hints, &results)) != 0) {
         cerr << "getaddrinfo() failed: " << gai_strerror(gaiResult) << endl;
-        exit(EXIT_FAILURE);
+        return -1;
     }
     
     int serverSocket;
@@ -402,15 +744,15 @@ int connectToServer(const string& hostName, const string& port) {
         break;
     }
     
+    // Free the memory allocated for the results
+    freeaddrinfo(results);
+    
     // If we looped through all the results without being able to connect
     if (current == nullptr) {
-        cerr << "Failed to connect" << endl;
-        exit(EXIT_FAILURE);
+        cerr << "Failed to connect to " << hostName << endl;
+        return -1;
     }
     
-    // Free the memory allocated for the results
-    freeaddrinfo(results);
-    
     return serverSocket;
 }
 
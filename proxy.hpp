@@ -13,17 +13,27 @@
 #include <netdb.h>
 #include <netinet/in.h>
 #include <pthread.h>
+#include <signal.h>
 #include <sys/socket.h>
 #include <sys/types.h>
 #include <unistd.h>
 
 #include "Cache.hpp"
 #include "CacheItem.hpp"
+#include "Http.hpp"
+#include "Prefetcher.hpp"
+#include "UrlNormalizer.hpp"
 
 using namespace std;
 
 using Clock = chrono::high_resolution_clock;
 
+enum FetchResult {
+    FETCH_OK,        // the whole response was received
+    FETCH_TOO_LARGE, // the response is larger than the size limit, so it wasn't downloaded
+    FETCH_FAILED     // the server couldn't be reached, or the response was cut off
+};
+
 struct ClientInfo {
     int               socket;
     string            ipAddress;
@@ -33,7 +43,13 @@ struct ClientInfo {
 string     getProxyHostName();
 int        getProxyPort(const int& socket, const struct sockaddr_in& sa);
 void*      requestHandler(void* ci);
-CacheItem* talkToServer(const string& request, const string& url);
+RangeResult checkRange(const string& requestHeaders, const CacheItem* item, int& start, int& end);
+string     buildPartialResponseHeader(const CacheItem* item, const int start, const int end);
+bool       sendAll(const int& socket, const char* buffer, const int& length);
+FetchResult talkToServer(const string& request, const string& url, const string& key, const int sizeLimit, CacheItem*& item);
+FetchResult fetchFromServer(const string& request, const string& url, const string& key, const int sizeLimit, CacheItem*& item);
+int        relayFromServer(const int& clientSocket, const string& request, const string& url);
+int        sendRequestToServer(const string& request, const string& url, const bool keepRange);
 int        connectToServer(const string& hostName, const string& port);
 
 #endif